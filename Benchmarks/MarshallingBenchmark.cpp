@@ -0,0 +1,145 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MarshallingKernels.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+using namespace Marshalling;
+
+/** Stand-in for GenericProcessor::getGlobalChannelIndex, which looks the channel up per call */
+static std::map<std::pair<int, int>, int> channelMap;
+
+__attribute__((noinline)) static int getGlobalChannelIndex(int streamId, int channel)
+{
+	return channelMap.at({ streamId, channel });
+}
+
+/** The per-channel lookup and memcpy loops that process() used before the kernels */
+static void oldPackUnpack(float* const* buffer, float* array, int numChannels, int numSamples)
+{
+	for (int i = 0; i < numChannels; ++i)
+	{
+		int globalChannelIndex = getGlobalChannelIndex(1, i);
+		memcpy(array + (size_t) i * numSamples, buffer[globalChannelIndex], sizeof(float) * numSamples);
+	}
+
+	for (int i = 0; i < numChannels; ++i)
+	{
+		int globalChannelIndex = getGlobalChannelIndex(1, i);
+		memcpy(buffer[globalChannelIndex], array + (size_t) i * numSamples, sizeof(float) * numSamples);
+	}
+}
+
+/** Returns the best of several runs, in microseconds per block, to keep scheduler noise out */
+template <typename Function>
+static double timeBlocks(int numBlocks, Function function)
+{
+	function(); // warm up
+
+	double best = 0.0;
+
+	for (int run = 0; run < 5; ++run)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		for (int n = 0; n < numBlocks; ++n)
+			function();
+
+		const double time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / numBlocks;
+
+		if (run == 0 || time < best)
+			best = time;
+	}
+
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	const int numChannels = argc > 1 ? atoi(argv[1]) : 384;
+	const int numSamples = argc > 2 ? atoi(argv[2]) : 1024;
+	const int numBlocks = 500;
+
+	// Offset the stream's channels inside a larger buffer, as in a multi-stream chain
+	const int firstChannel = 8;
+
+	std::vector<std::vector<float>> channels(numChannels + firstChannel, std::vector<float>(numSamples, 1.0f));
+	std::vector<float*> buffer;
+	std::vector<int> channelIndex;
+
+	for (auto& channel : channels)
+		buffer.push_back(channel.data());
+
+	for (int i = 0; i < numChannels; ++i)
+	{
+		channelMap[{ 1, i }] = firstChannel + i;
+		channelIndex.push_back(firstChannel + i);
+	}
+
+	std::vector<double> array((size_t) numChannels * numSamples);
+
+	printf("%d channels x %d samples, mean time per block (pack + unpack)\n\n", numChannels, numSamples);
+
+	const double oldTime = timeBlocks(numBlocks, [&]() {
+		oldPackUnpack(buffer.data(), (float*) array.data(), numChannels, numSamples);
+	});
+
+	printf("%-40s %8.1f us\n", "old per-channel memcpy (float32, CxS)", oldTime);
+
+	const char* typeNames[] = { "float32", "float64" };
+	const char* layoutNames[] = { "CxS", "SxC" };
+
+	for (int type = 0; type < 2; ++type)
+	{
+		for (int layout = 0; layout < 2; ++layout)
+		{
+			const Plan plan = createPlan((DataType) type, (Layout) layout, channelIndex);
+			const Plan generic = createPlan((DataType) type, (Layout) layout, std::vector<int>());
+
+			const Kernel& kernel = plan.getKernel(numSamples);
+			const Kernel& fallback = generic.anySize;
+
+			const double kernelTime = timeBlocks(numBlocks, [&]() {
+				kernel.pack(buffer.data(), channelIndex.data(), array.data(), numChannels, numSamples);
+				kernel.unpack(array.data(), buffer.data(), channelIndex.data(), numChannels, numSamples);
+			});
+
+			const double fallbackTime = timeBlocks(numBlocks, [&]() {
+				fallback.pack(buffer.data(), channelIndex.data(), array.data(), numChannels, numSamples);
+				fallback.unpack(array.data(), buffer.data(), channelIndex.data(), numChannels, numSamples);
+			});
+
+			char name[64];
+			snprintf(name, sizeof(name), "%s %s selected kernel (%dx%d)", typeNames[type], layoutNames[layout],
+				kernel.numChannels, kernel.numSamples);
+
+			printf("%-40s %8.1f us  (%.2fx old, %.2fx generic)\n", name, kernelTime,
+				oldTime / kernelTime, fallbackTime / kernelTime);
+		}
+	}
+
+	return 0;
+}
@@ -2,12 +2,30 @@ import numpy as np
 
 class PyProcessor:
     
+    # Parameters shown in the plugin editor and saved with the signal chain.
+    # Current values are available as attributes of self.params
+    # (e.g. self.params.threshold), including in __init__, and are
+    # updated between blocks.
+    # Types: "float" and "int" (default, min, max, optional step),
+    # "bool" (default) and "categorical" (categories, default index).
+    parameters = [
+        # {"name": "threshold", "type": "float", "default": 50.0, "min": 0.0, "max": 500.0},
+    ]
+    
     # A new processor is initialized whenever the plugin settings are updated
     def __init__(self, num_channels, sample_rate):
         pass
     
-    # Process each data buffer. Data is a numpy array.
-    def process(self, data):
+    # Process each data buffer. Data is a numpy array, channels x samples
+    # float32 by default (the type and shape can be changed in the editor).
+    # info holds the timing of the block (stream_id, sample_rate,
+    # first_sample_number, first_timestamp, num_samples, block_index and
+    # dropped, which is True if samples were skipped since the previous block)
+    # and its TTL events as arrays (ttl_offsets into the block, ttl_lines,
+    # ttl_states). The same info object is reused for every block, so copy
+    # any values that must outlive the call. info can be omitted from the
+    # signature if it isn't needed.
+    def process(self, data, info):
         pass
         
     # Called at start of acquisition
@@ -26,6 +44,10 @@ class PyProcessor:
     def handle_spike_event(self):
         pass
     
+    # Respond to broadcast messages (delivered before the next block)
+    def handle_broadcast_message(self, message):
+        pass
+    
     # Called when recording starts
     def start_recording(self, recording_dir):
         pass
@@ -0,0 +1,127 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BLOCKINFO_H_DEFINED
+#define BLOCKINFO_H_DEFINED
+
+#include <pybind11/numpy.h>
+
+#include <cstdint>
+
+namespace py = pybind11;
+
+/** Maximum number of TTL events reported per stream and block */
+#define MAX_TTL_EVENTS_PER_BLOCK 256
+
+/** Timing metadata passed to PyProcessor.process() with each block.
+
+	One instance is created per stream in updateSettings and reused for every
+	block, so nothing is allocated on the processing thread. The TTL arrays
+	are preallocated to MAX_TTL_EVENTS_PER_BLOCK; Python sees views covering
+	the events of the current block. */
+struct BlockInfo
+{
+	/** Constructor, allocates the TTL arrays (GIL must be held) */
+	BlockInfo(uint16_t streamId_, float sampleRate_)
+		: streamId(streamId_),
+		  sampleRate(sampleRate_),
+		  firstSampleNumber(0),
+		  firstTimestamp(0.0),
+		  numSamples(0),
+		  blockIndex(-1),
+		  dropped(false),
+		  numTtlEvents(0),
+		  ttlOverflow(false),
+		  ttlOffsets(MAX_TTL_EVENTS_PER_BLOCK),
+		  ttlLines(MAX_TTL_EVENTS_PER_BLOCK),
+		  ttlStates(MAX_TTL_EVENTS_PER_BLOCK)
+	{
+		ttlOffsetData = ttlOffsets.mutable_data();
+		ttlLineData = ttlLines.mutable_data();
+		ttlStateData = ttlStates.mutable_data();
+	}
+
+	/** Clears the TTL events of the previous block */
+	void clearEvents()
+	{
+		numTtlEvents = 0;
+		ttlOverflow = false;
+	}
+
+	/** Records a TTL event at a sample offset into the block */
+	void addTtlEvent(int64_t offset, int line, bool state)
+	{
+		if (numTtlEvents == MAX_TTL_EVENTS_PER_BLOCK)
+		{
+			ttlOverflow = true;
+			return;
+		}
+
+		ttlOffsetData[numTtlEvents] = offset;
+		ttlLineData[numTtlEvents] = (int16_t) line;
+		ttlStateData[numTtlEvents] = state;
+		numTtlEvents++;
+	}
+
+	/** Updates the timing fields for a new block. dropped is set if the
+		first sample doesn't follow on from the previous block */
+	void startBlock(int64_t firstSampleNumber_, double firstTimestamp_, int numSamples_)
+	{
+		dropped = blockIndex >= 0 && firstSampleNumber_ != firstSampleNumber + numSamples;
+
+		firstSampleNumber = firstSampleNumber_;
+		firstTimestamp = firstTimestamp_;
+		numSamples = numSamples_;
+		blockIndex++;
+	}
+
+	/** Restarts block counting (called at the start of acquisition) */
+	void reset()
+	{
+		blockIndex = -1;
+		dropped = false;
+		clearEvents();
+	}
+
+	uint16_t streamId;
+	float sampleRate;
+	int64_t firstSampleNumber;
+	double firstTimestamp;
+	int numSamples;
+	int64_t blockIndex;
+	bool dropped;
+
+	int numTtlEvents;
+	bool ttlOverflow;
+
+	py::array_t<int64_t> ttlOffsets;
+	py::array_t<int16_t> ttlLines;
+	py::array_t<bool> ttlStates;
+
+private:
+
+	int64_t* ttlOffsetData;
+	int16_t* ttlLineData;
+	bool* ttlStateData;
+};
+
+#endif // BLOCKINFO_H_DEFINED
@@ -0,0 +1,236 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MARSHALLINGKERNELS_H_DEFINED
+#define MARSHALLINGKERNELS_H_DEFINED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Kernels that copy a stream's channels between the GUI's AudioBuffer and the
+	array passed to Python.
+
+	Each kernel is specialized on element type and array layout. The float32
+	samples x channels transpose is also specialized on common channel counts and
+	block sizes, which is the only case where a fixed shape measurably helps (see
+	Benchmarks/MarshallingBenchmark.cpp); the other cases are memory bound and use
+	the generic kernel (shape 0 x 0). Kernels are selected once per stream in
+	updateSettings. */
+namespace Marshalling
+{
+
+	/** Element type of the array passed to Python */
+	enum class DataType
+	{
+		FLOAT32 = 0,
+		FLOAT64
+	};
+
+	/** Shape of the array passed to Python */
+	enum class Layout
+	{
+		CHANNELS_BY_SAMPLES = 0,	// one contiguous row per channel
+		SAMPLES_BY_CHANNELS			// one contiguous row per sample
+	};
+
+	/** Channel counts and block sizes with dedicated float32 transpose kernels */
+	using SpecializedChannelCounts = std::integer_sequence<int, 16, 32, 64, 128, 192, 256, 384>;
+	using SpecializedBlockSizes = std::integer_sequence<int, 512, 1024>;
+
+	constexpr int NUM_SPECIALIZED_BLOCK_SIZES = 2;
+
+	/** Number of samples transposed at a time, so the channel rows being read stay in cache */
+	constexpr int TRANSPOSE_TILE = 32;
+
+	/** Gathers the channels in channelIndex from source into the array at dest */
+	typedef void (*PackFunction)(const float* const* source, const int* channelIndex, void* dest, int numChannels, int numSamples);
+
+	/** Scatters the array at source back to the channels in channelIndex */
+	typedef void (*UnpackFunction)(const void* source, float* const* dest, const int* channelIndex, int numChannels, int numSamples);
+
+	template <typename T, Layout L, int C, int S>
+	void pack(const float* const* source, const int* channelIndex, void* dest, int numChannels, int numSamples)
+	{
+		const int channels = C > 0 ? C : numChannels;
+		const int samples = S > 0 ? S : numSamples;
+		T* array = static_cast<T*>(dest);
+
+		if constexpr (L == Layout::CHANNELS_BY_SAMPLES)
+		{
+			for (int c = 0; c < channels; ++c)
+			{
+				const float* in = source[channelIndex[c]];
+				T* out = array + (size_t) c * samples;
+
+				if constexpr (std::is_same<T, float>::value)
+					std::memcpy(out, in, sizeof(float) * samples);
+				else
+					for (int s = 0; s < samples; ++s)
+						out[s] = (T) in[s];
+			}
+		}
+		else
+		{
+			for (int tileStart = 0; tileStart < samples; tileStart += TRANSPOSE_TILE)
+			{
+				const int tileEnd = std::min(tileStart + TRANSPOSE_TILE, samples);
+
+				for (int c = 0; c < channels; ++c)
+				{
+					const float* in = source[channelIndex[c]];
+
+					for (int s = tileStart; s < tileEnd; ++s)
+						array[(size_t) s * channels + c] = (T) in[s];
+				}
+			}
+		}
+	}
+
+	template <typename T, Layout L, int C, int S>
+	void unpack(const void* source, float* const* dest, const int* channelIndex, int numChannels, int numSamples)
+	{
+		const int channels = C > 0 ? C : numChannels;
+		const int samples = S > 0 ? S : numSamples;
+		const T* array = static_cast<const T*>(source);
+
+		if constexpr (L == Layout::CHANNELS_BY_SAMPLES)
+		{
+			for (int c = 0; c < channels; ++c)
+			{
+				const T* in = array + (size_t) c * samples;
+				float* out = dest[channelIndex[c]];
+
+				if constexpr (std::is_same<T, float>::value)
+					std::memcpy(out, in, sizeof(float) * samples);
+				else
+					for (int s = 0; s < samples; ++s)
+						out[s] = (float) in[s];
+			}
+		}
+		else
+		{
+			for (int tileStart = 0; tileStart < samples; tileStart += TRANSPOSE_TILE)
+			{
+				const int tileEnd = std::min(tileStart + TRANSPOSE_TILE, samples);
+
+				for (int c = 0; c < channels; ++c)
+				{
+					float* out = dest[channelIndex[c]];
+
+					for (int s = tileStart; s < tileEnd; ++s)
+						out[s] = (float) array[(size_t) s * channels + c];
+				}
+			}
+		}
+	}
+
+	/** A pack/unpack pair and the shape it was specialized for (0 = any) */
+	struct Kernel
+	{
+		PackFunction pack;
+		UnpackFunction unpack;
+		int numChannels;
+		int numSamples;
+	};
+
+	template <typename T, Layout L, int C, int S>
+	Kernel makeKernel()
+	{
+		return { &pack<T, L, C, S>, &unpack<T, L, C, S>, C, S };
+	}
+
+	/** Kernels and channel index table for one stream */
+	struct Plan
+	{
+		/** Global buffer channel for each channel of the stream */
+		std::vector<int> channelIndex;
+
+		/** Kernels for the specialized block sizes */
+		Kernel sized[NUM_SPECIALIZED_BLOCK_SIZES];
+
+		/** Kernel for any other block size */
+		Kernel anySize;
+
+		/** Returns the kernel to use for a block */
+		const Kernel& getKernel(int numSamples) const
+		{
+			for (auto& kernel : sized)
+			{
+				if (kernel.numSamples == numSamples)
+					return kernel;
+			}
+
+			return anySize;
+		}
+	};
+
+	template <typename T, Layout L, int C, int... Sizes>
+	void fillBlockSizeKernels(Plan& plan, std::integer_sequence<int, Sizes...>)
+	{
+		plan.anySize = makeKernel<T, L, C, 0>();
+
+		int i = 0;
+		((plan.sized[i++] = makeKernel<T, L, C, Sizes>()), ...);
+	}
+
+	template <typename T, Layout L, int... Counts>
+	void fillChannelCountKernels(Plan& plan, int numChannels, std::integer_sequence<int, Counts...>)
+	{
+		// Generic fallback, with the sized slots disabled
+		plan.anySize = makeKernel<T, L, 0, 0>();
+
+		for (auto& kernel : plan.sized)
+			kernel = { nullptr, nullptr, 0, -1 };
+
+		if constexpr (std::is_same<T, float>::value && L == Layout::SAMPLES_BY_CHANNELS)
+			(void) ((numChannels == Counts && (fillBlockSizeKernels<T, L, Counts>(plan, SpecializedBlockSizes()), true)) || ...);
+	}
+
+	template <typename T>
+	void fillLayoutKernels(Plan& plan, Layout layout, int numChannels)
+	{
+		if (layout == Layout::CHANNELS_BY_SAMPLES)
+			fillChannelCountKernels<T, Layout::CHANNELS_BY_SAMPLES>(plan, numChannels, SpecializedChannelCounts());
+		else
+			fillChannelCountKernels<T, Layout::SAMPLES_BY_CHANNELS>(plan, numChannels, SpecializedChannelCounts());
+	}
+
+	/** Chooses the kernels for a stream with the given buffer channel indices */
+	inline Plan createPlan(DataType type, Layout layout, const std::vector<int>& channelIndex)
+	{
+		Plan plan;
+		plan.channelIndex = channelIndex;
+
+		if (type == DataType::FLOAT32)
+			fillLayoutKernels<float>(plan, layout, (int) channelIndex.size());
+		else
+			fillLayoutKernels<double>(plan, layout, (int) channelIndex.size());
+
+		return plan;
+	}
+}
+
+#endif // MARSHALLINGKERNELS_H_DEFINED
@@ -0,0 +1,114 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARAMETERSNAPSHOT_H_DEFINED
+#define PARAMETERSNAPSHOT_H_DEFINED
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/** Double-buffered set of parameter values, written by one thread (the message thread)
+	and read by another (the processing thread) without locks.
+
+	Each publish fills the buffer that is not currently visible and then bumps the
+	version, which flips it to the front. A reader that is overtaken by two publishes
+	while copying drops that copy and picks up the latest values at the next block,
+	so neither side ever waits on the other. */
+class ParameterSnapshot
+{
+public:
+
+	/** Constructor */
+	ParameterSnapshot() : published(0), started(0) { }
+
+	/** Resizes the snapshot and sets every value to zero. Must not be
+		called while the reader may be active */
+	void reset(int numValues)
+	{
+		for (auto& buffer : buffers)
+			buffer = std::vector<std::atomic<float>>(numValues);
+
+		published.store(0);
+		started.store(0);
+	}
+
+	/** Returns the number of values in the snapshot */
+	int size() const { return (int) buffers[0].size(); }
+
+	/** Publishes a new value for one entry (writer thread only) */
+	void publish(int index, float value)
+	{
+		if (index < 0 || index >= size())
+			return;
+
+		const uint64_t next = published.load(std::memory_order_relaxed) + 1;
+
+		started.store(next, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		const std::vector<std::atomic<float>>& current = buffers[(next - 1) & 1];
+		std::vector<std::atomic<float>>& back = buffers[next & 1];
+
+		for (int i = 0; i < size(); ++i)
+			back[i].store(current[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		back[index].store(value, std::memory_order_relaxed);
+
+		published.store(next, std::memory_order_release);
+	}
+
+	/** Copies the latest values into dest if they changed since lastVersion (reader thread only).
+		Returns true if dest was updated */
+	bool read(std::vector<float>& dest, uint64_t& lastVersion) const
+	{
+		const uint64_t version = published.load(std::memory_order_acquire);
+
+		if (version == lastVersion)
+			return false;
+
+		const std::vector<std::atomic<float>>& front = buffers[version & 1];
+
+		dest.resize(front.size());
+
+		for (size_t i = 0; i < front.size(); ++i)
+			dest[i] = front[i].load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// The writer only reuses this buffer two publishes later
+		if (started.load(std::memory_order_relaxed) > version + 1)
+			return false;
+
+		lastVersion = version;
+		return true;
+	}
+
+private:
+
+	std::vector<std::atomic<float>> buffers[2];
+
+	std::atomic<uint64_t> published;
+	std::atomic<uint64_t> started;
+};
+
+#endif // PARAMETERSNAPSHOT_H_DEFINED
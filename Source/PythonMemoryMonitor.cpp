@@ -0,0 +1,488 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PythonMemoryMonitor.h"
+
+#if JUCE_WINDOWS
+#include <Windows.h>
+#include <psapi.h>
+#elif JUCE_MAC
+#include <mach/mach.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+
+/** Number of monitors that have disabled automatic garbage collection. The
+    collector is interpreter-wide, so it is disabled by the first node to start
+    and enabled again by the last one to stop. Only changed with the GIL held */
+static int numGcDisabled = 0;
+
+
+PythonMemoryMonitor::PythonMemoryMonitor()
+{
+    mode = GCMode::AUTOMATIC;
+    collectionIntervalMs = 10000;
+    lastCollectionTicks = 0;
+    lastRssSampleTicks = 0;
+    tracing = false;
+    startedTracing = false;
+    blocksAtLastSample = 0;
+    numBlocksAtLastSample = 0;
+    tracedAtBlockStart = -1;
+    gcStartTicks = 0;
+
+    inBlock = false;
+    lastBlockEndTicks = 0;
+    blockIntervalTicks = 0;
+    numBlocks = 0;
+    lastBlockChange = 0.0;
+    maxBlockChange = 0.0;
+    lastBlockBytes = 0;
+    maxBlockBytes = 0;
+    pythonBlocks = 0;
+    pythonBlocksAtStart = 0;
+    tracedBytes = 0;
+    residentBytes = getResidentBytes();
+    residentBytesAtStart = residentBytes.load();
+    numCollections = 0;
+    numCollectionsInBlock = 0;
+    lastPauseMs = 0.0;
+    maxPauseMs = 0.0;
+
+    lastSnapshot = NULL;
+
+    py::gil_scoped_acquire acquire;
+
+    getAllocatedBlocks = new py::object(py::module_::import("sys").attr("getallocatedblocks"));
+    gcModule = new py::object(py::module_::import("gc"));
+    tracemallocModule = new py::object(py::module_::import("tracemalloc"));
+
+    // reset_peak() is only available from Python 3.9
+    canResetPeak = py::hasattr(*tracemallocModule, "reset_peak");
+
+    gcCallbackFunction = new py::object(py::cpp_function([this](std::string phase, py::dict info)
+    {
+        gcCallback(phase);
+    }));
+
+    gcModule->attr("callbacks").attr("append")(*gcCallbackFunction);
+}
+
+PythonMemoryMonitor::~PythonMemoryMonitor()
+{
+    stopTimer();
+    stopTracing();
+
+    py::gil_scoped_acquire acquire;
+
+    try {
+        gcModule->attr("callbacks").attr("remove")(*gcCallbackFunction);
+    }
+    catch (py::error_already_set& e) {
+        LOGC("Failed to remove GC callback: ", e.what());
+    }
+
+    delete gcCallbackFunction;
+    delete lastSnapshot;
+    delete tracemallocModule;
+    delete gcModule;
+    delete getAllocatedBlocks;
+}
+
+
+void PythonMemoryMonitor::beginBlock()
+{
+    // Python may release the GIL inside a block, so tracemalloc can be
+    // started part way through; only measure bytes when it was on at the start
+    if (tracing)
+    {
+        if (canResetPeak)
+            tracemallocModule->attr("reset_peak")();
+
+        tracedAtBlockStart = tracemallocModule->attr("get_traced_memory")().cast<py::tuple>()[0].cast<int64>();
+    }
+    else
+    {
+        tracedAtBlockStart = -1;
+    }
+
+    inBlock = true;
+}
+
+
+void PythonMemoryMonitor::endBlock()
+{
+    inBlock = false;
+
+    if (tracing && tracedAtBlockStart >= 0)
+    {
+        py::tuple traced = tracemallocModule->attr("get_traced_memory")();
+        const int64 current = traced[0].cast<int64>();
+        const int64 peak = traced[1].cast<int64>();
+
+        // With reset_peak() the peak covers transient allocations too
+        const int64 bytes = (canResetPeak ? peak : current) - tracedAtBlockStart;
+
+        tracedBytes = current;
+        lastBlockBytes = bytes;
+
+        if (bytes > maxBlockBytes)
+            maxBlockBytes = bytes;
+    }
+
+    const int64 now = Time::getHighResolutionTicks();
+    const int64 previous = lastBlockEndTicks.exchange(now);
+
+    if (previous > 0)
+    {
+        // Smoothed so that a single late block doesn't shift the idle window
+        const int64 interval = blockIntervalTicks;
+        blockIntervalTicks = interval == 0 ? now - previous : (interval * 7 + (now - previous)) / 8;
+    }
+
+    numBlocks++;
+}
+
+
+void PythonMemoryMonitor::startAcquisition(GCMode mode_, int intervalMs)
+{
+    mode = mode_;
+    collectionIntervalMs = intervalMs;
+
+    numBlocks = 0;
+    numBlocksAtLastSample = 0;
+    lastBlockChange = 0.0;
+    maxBlockChange = 0.0;
+    lastBlockBytes = 0;
+    maxBlockBytes = 0;
+    numCollections = 0;
+    numCollectionsInBlock = 0;
+    lastPauseMs = 0.0;
+    maxPauseMs = 0.0;
+    lastBlockEndTicks = 0;
+    blockIntervalTicks = 0;
+
+    residentBytes = getResidentBytes();
+    residentBytesAtStart = residentBytes.load();
+    lastRssSampleTicks = Time::getHighResolutionTicks();
+    lastCollectionTicks = lastRssSampleTicks;
+
+    {
+        py::gil_scoped_acquire acquire;
+
+        pythonBlocks = (*getAllocatedBlocks)().cast<int64>();
+        pythonBlocksAtStart = pythonBlocks.load();
+        blocksAtLastSample = pythonBlocks.load();
+
+        if (mode != GCMode::AUTOMATIC && numGcDisabled++ == 0)
+        {
+            gcModule->attr("disable")();
+            LOGC("Automatic Python garbage collection disabled during acquisition");
+        }
+    }
+
+    // Both scheduled modes wait for the gap after a block, so they need a fine timer
+    startTimer(mode == GCMode::AUTOMATIC ? 100 : 5);
+}
+
+
+void PythonMemoryMonitor::stopAcquisition()
+{
+    stopTimer();
+
+    if (mode != GCMode::AUTOMATIC)
+    {
+        collect(2);
+
+        py::gil_scoped_acquire acquire;
+
+        if (--numGcDisabled == 0)
+            gcModule->attr("enable")();
+    }
+
+    LOGC("Python memory: ", getDetails().replace("\n", ", "));
+
+    // Tracing slows down every allocation in the GUI, so it doesn't outlive the acquisition
+    stopTracing();
+}
+
+
+void PythonMemoryMonitor::timerCallback()
+{
+    const int64 now = Time::getHighResolutionTicks();
+
+    if (Time::highResolutionTicksToSeconds(now - lastRssSampleTicks) >= 0.5)
+    {
+        residentBytes = getResidentBytes();
+        lastRssSampleTicks = now;
+
+        sampleHeap();
+    }
+
+    if (mode == GCMode::TIMER)
+    {
+        // Once the interval has elapsed, wait for the next gap after a block
+        if (Time::highResolutionTicksToSeconds(now - lastCollectionTicks) * 1000.0 >= collectionIntervalMs
+            && isIdleGap(now))
+        {
+            collect(2);
+            lastCollectionTicks = now;
+        }
+    }
+    else if (mode == GCMode::IDLE_GAPS)
+    {
+        if (!isIdleGap(now))
+            return;
+
+        py::gil_scoped_acquire acquire;
+
+        // Same escalation as Python's automatic collector
+        py::tuple counts = gcModule->attr("get_count")();
+        py::tuple thresholds = gcModule->attr("get_threshold")();
+
+        for (int generation = 2; generation >= 0; --generation)
+        {
+            const int threshold = thresholds[generation].cast<int>();
+
+            if (threshold > 0 && counts[generation].cast<int>() >= threshold)
+            {
+                gcModule->attr("collect")(generation);
+                break;
+            }
+        }
+    }
+}
+
+
+void PythonMemoryMonitor::sampleHeap()
+{
+    // getallocatedblocks() walks the heap, so its cost grows with the number of
+    // live blocks; it is sampled here rather than around every process call
+    int64 blocks;
+
+    {
+        py::gil_scoped_acquire acquire;
+        blocks = (*getAllocatedBlocks)().cast<int64>();
+    }
+
+    const int64 processed = numBlocks;
+    const int64 newBlocks = processed - numBlocksAtLastSample;
+
+    if (newBlocks > 0)
+    {
+        const double change = (double) (blocks - blocksAtLastSample) / newBlocks;
+
+        lastBlockChange = change;
+
+        if (change > maxBlockChange)
+            maxBlockChange = change;
+    }
+
+    pythonBlocks = blocks;
+    blocksAtLastSample = blocks;
+    numBlocksAtLastSample = processed;
+}
+
+
+bool PythonMemoryMonitor::isIdleGap(int64 now) const
+{
+    const int64 interval = blockIntervalTicks;
+    const int64 sinceLastBlock = now - lastBlockEndTicks;
+
+    // Just after a block has finished, or when blocks have stopped arriving
+    return interval > 0 && !inBlock && (sinceLastBlock <= interval / 2 || sinceLastBlock >= interval * 2);
+}
+
+
+void PythonMemoryMonitor::collect(int generation)
+{
+    py::gil_scoped_acquire acquire;
+
+    try {
+        gcModule->attr("collect")(generation);
+    }
+    catch (py::error_already_set& e) {
+        LOGC("Python garbage collection failed: ", e.what());
+    }
+}
+
+
+void PythonMemoryMonitor::gcCallback(const std::string& phase)
+{
+    const int64 now = Time::getHighResolutionTicks();
+
+    if (phase == "start")
+    {
+        gcStartTicks = now;
+        return;
+    }
+
+    const double pauseMs = Time::highResolutionTicksToSeconds(now - gcStartTicks) * 1000.0;
+
+    lastPauseMs = pauseMs;
+
+    if (pauseMs > maxPauseMs)
+        maxPauseMs = pauseMs;
+
+    numCollections++;
+
+    if (inBlock)
+        numCollectionsInBlock++;
+}
+
+
+void PythonMemoryMonitor::takeSnapshot()
+{
+    py::gil_scoped_acquire acquire;
+
+    try {
+        if (!tracing)
+        {
+            // Leave tracing alone at the end if something else had already started it
+            startedTracing = !tracemallocModule->attr("is_tracing")().cast<bool>();
+
+            // One frame per trace keeps the tracing overhead low
+            if (startedTracing)
+                tracemallocModule->attr("start")(1);
+
+            tracing = true;
+
+            delete lastSnapshot;
+            lastSnapshot = new py::object(tracemallocModule->attr("take_snapshot")());
+
+            LOGC("Started tracemalloc. Take another snapshot to see allocation growth.");
+            return;
+        }
+
+        py::object snapshot = tracemallocModule->attr("take_snapshot")();
+        py::list stats = snapshot.attr("compare_to")(*lastSnapshot, "lineno");
+
+        LOGC("Largest Python allocation changes since the last snapshot:");
+
+        for (int i = 0; i < 10 && i < stats.size(); ++i)
+            LOGC(py::str(stats[i]).cast<std::string>());
+
+        delete lastSnapshot;
+        lastSnapshot = new py::object(snapshot);
+    }
+    catch (py::error_already_set& e) {
+        LOGC("Failed to take tracemalloc snapshot: ", e.what());
+    }
+}
+
+
+void PythonMemoryMonitor::stopTracing()
+{
+    py::gil_scoped_acquire acquire;
+
+    if (!tracing)
+        return;
+
+    try {
+        if (startedTracing)
+            tracemallocModule->attr("stop")();
+
+        LOGC("Stopped tracemalloc.");
+    }
+    catch (py::error_already_set& e) {
+        LOGC("Failed to stop tracemalloc: ", e.what());
+    }
+
+    tracing = false;
+    startedTracing = false;
+
+    delete lastSnapshot;
+    lastSnapshot = NULL;
+}
+
+
+String PythonMemoryMonitor::getSummary() const
+{
+    const double rssMb = residentBytes / (1024.0 * 1024.0);
+    const double growthMb = (residentBytes - residentBytesAtStart) / (1024.0 * 1024.0);
+
+    return "RSS " + String(rssMb, 0) + " MB (" + (growthMb >= 0 ? "+" : "") + String(growthMb, 1)
+        + ") GC " + String(lastPauseMs.load(), 1) + "/" + String(maxPauseMs.load(), 1) + " ms";
+}
+
+
+String PythonMemoryMonitor::getDetails() const
+{
+    String details;
+
+    details << "RSS: " << String(residentBytes / (1024.0 * 1024.0), 1) << " MB, "
+        << String((residentBytes - residentBytesAtStart) / (1024.0 * 1024.0), 1) << " MB since start\n";
+    details << "Python heap: " << pythonBlocks.load() << " live blocks, "
+        << (pythonBlocks - pythonBlocksAtStart) << " since start\n";
+    details << "Net live-block change per process call: " << String(lastBlockChange.load(), 1)
+        << " (max " << String(maxBlockChange.load(), 1) << "), averaged over 0.5 s\n";
+
+    if (tracing)
+    {
+        details << "Traced memory: " << String(tracedBytes / 1024.0, 1) << " kB, per process call "
+            << lastBlockBytes.load() << " bytes (max " << maxBlockBytes.load() << ")\n";
+    }
+
+    details << "GC pauses: " << numCollections.load() << " (" << numCollectionsInBlock.load()
+        << " during process), last " << String(lastPauseMs.load(), 2) << " ms, max "
+        << String(maxPauseMs.load(), 2) << " ms";
+
+    return details;
+}
+
+
+int64 PythonMemoryMonitor::getResidentBytes()
+{
+#if JUCE_WINDOWS
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return (int64) counters.WorkingSetSize;
+
+    return 0;
+#elif JUCE_MAC
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS)
+        return (int64) info.resident_size;
+
+    return 0;
+#else
+    long totalPages = 0;
+    long residentPages = 0;
+
+    FILE* statm = fopen("/proc/self/statm", "r");
+
+    if (statm == NULL)
+        return 0;
+
+    if (fscanf(statm, "%ld %ld", &totalPages, &residentPages) != 2)
+        residentPages = 0;
+
+    fclose(statm);
+
+    return (int64) residentPages * sysconf(_SC_PAGESIZE);
+#endif
+}
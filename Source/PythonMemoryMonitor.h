@@ -0,0 +1,158 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PYTHONMEMORYMONITOR_H_DEFINED
+#define PYTHONMEMORYMONITOR_H_DEFINED
+
+#include <ProcessorHeaders.h>
+#include <pybind11/embed.h>
+
+#include <atomic>
+
+namespace py = pybind11;
+
+/** How Python's cyclic garbage collector is run during acquisition */
+enum class GCMode
+{
+	AUTOMATIC = 0,	// Python's own generational thresholds
+	IDLE_GAPS,		// automatic GC off, collect between blocks
+	TIMER			// automatic GC off, full collection between blocks at a fixed interval
+};
+
+/** Tracks Python memory use and garbage collector pauses for one processor,
+	and optionally takes over scheduling of the cyclic garbage collector.
+
+	Per-block measurements are only taken on the processing thread while
+	tracemalloc is on; everything else (RSS and Python heap sampling, scheduled
+	collections, tracemalloc snapshots) runs on the message thread.
+
+	The garbage collector belongs to the interpreter, which is shared by every
+	node: automatic collection stays disabled while any node uses a scheduled
+	mode, and the pause statistics include collections run by any node. */
+class PythonMemoryMonitor : public Timer
+{
+public:
+
+	/** Constructor (acquires the GIL) */
+	PythonMemoryMonitor();
+
+	/** Destructor (acquires the GIL) */
+	~PythonMemoryMonitor();
+
+	/** Called on the processing thread, with the GIL held, before the script processes a block */
+	void beginBlock();
+
+	/** Called on the processing thread, with the GIL held, after the script processes a block */
+	void endBlock();
+
+	/** Resets statistics and applies the GC mode for this acquisition */
+	void startAcquisition(GCMode mode, int intervalMs);
+
+	/** Restores automatic garbage collection */
+	void stopAcquisition();
+
+	/** Logs the largest allocation sites. The first call starts tracemalloc,
+		later calls report the growth since the previous snapshot */
+	void takeSnapshot();
+
+	/** Stops tracemalloc and discards the last snapshot. Also called when
+		acquisition stops */
+	void stopTracing();
+
+	/** Returns true while tracemalloc snapshots are being taken */
+	bool isTracing() const { return tracing; }
+
+	/** Short summary for the editor */
+	String getSummary() const;
+
+	/** Full statistics for the editor tooltip */
+	String getDetails() const;
+
+	/** Samples memory use and runs scheduled collections */
+	void timerCallback() override;
+
+private:
+
+	/** Samples the number of live Python blocks and the net change per block
+		since the previous sample (message thread, acquires the GIL) */
+	void sampleHeap();
+
+	/** Returns true just after a block has finished, or if blocks have stopped arriving */
+	bool isIdleGap(int64 now) const;
+
+	/** Runs a collection of the given generation, holding the GIL */
+	void collect(int generation);
+
+	/** Called from gc.callbacks at the start and end of every collection */
+	void gcCallback(const std::string& phase);
+
+	/** Returns the resident set size of the GUI process in bytes */
+	static int64 getResidentBytes();
+
+	py::object* getAllocatedBlocks;
+	py::object* gcModule;
+	py::object* tracemallocModule;
+	py::object* gcCallbackFunction;
+	py::object* lastSnapshot;
+
+	GCMode mode;
+	int collectionIntervalMs;
+	int64 lastCollectionTicks;
+	int64 lastRssSampleTicks;
+
+	std::atomic<bool> tracing;
+	bool startedTracing;
+	bool canResetPeak;
+
+	/** Heap and block counts at the previous heap sample (message thread only) */
+	int64 blocksAtLastSample;
+	int64 numBlocksAtLastSample;
+
+	/** Traced memory at the start of the current block (processing thread only) */
+	int64 tracedAtBlockStart;
+
+	/** Start of the collection in progress (thread running the collection) */
+	int64 gcStartTicks;
+
+	std::atomic<bool> inBlock;
+	std::atomic<int64> lastBlockEndTicks;
+	std::atomic<int64> blockIntervalTicks;
+
+	std::atomic<int64> numBlocks;
+	std::atomic<double> lastBlockChange;
+	std::atomic<double> maxBlockChange;
+	std::atomic<int64> lastBlockBytes;
+	std::atomic<int64> maxBlockBytes;
+
+	std::atomic<int64> pythonBlocks;
+	std::atomic<int64> pythonBlocksAtStart;
+	std::atomic<int64> tracedBytes;
+	std::atomic<int64> residentBytes;
+	std::atomic<int64> residentBytesAtStart;
+
+	std::atomic<int> numCollections;
+	std::atomic<int> numCollectionsInBlock;
+	std::atomic<double> lastPauseMs;
+	std::atomic<double> maxPauseMs;
+};
+
+#endif // PYTHONMEMORYMONITOR_H_DEFINED
@@ -30,21 +30,109 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 namespace py = pybind11;
 
 
+/** Module holding the types passed to scripts. Must be defined before
+    the interpreter is started so that it is added to the inittab */
+PYBIND11_EMBEDDED_MODULE(oe_pyprocessor, m)
+{
+    py::class_<BlockInfo>(m, "BlockInfo")
+        .def_readonly("stream_id", &BlockInfo::streamId)
+        .def_readonly("sample_rate", &BlockInfo::sampleRate)
+        .def_readonly("first_sample_number", &BlockInfo::firstSampleNumber)
+        .def_readonly("first_timestamp", &BlockInfo::firstTimestamp)
+        .def_readonly("num_samples", &BlockInfo::numSamples)
+        .def_readonly("block_index", &BlockInfo::blockIndex)
+        .def_readonly("dropped", &BlockInfo::dropped)
+        .def_readonly("ttl_overflow", &BlockInfo::ttlOverflow)
+        .def_property_readonly("ttl_offsets", [](const BlockInfo& b) {
+            return py::object(b.ttlOffsets[py::slice(0, b.numTtlEvents, 1)]);
+        })
+        .def_property_readonly("ttl_lines", [](const BlockInfo& b) {
+            return py::object(b.ttlLines[py::slice(0, b.numTtlEvents, 1)]);
+        })
+        .def_property_readonly("ttl_states", [](const BlockInfo& b) {
+            return py::object(b.ttlStates[py::slice(0, b.numTtlEvents, 1)]);
+        });
+}
+
+
 py::scoped_interpreter guard{};
 py::gil_scoped_release release;
 
 
+/** Converts a script parameter value from the snapshot to a Python object */
+static py::object toPythonValue(const ScriptParameter& scriptParameter, float value)
+{
+    switch (scriptParameter.type)
+    {
+    case ScriptParameter::INT:
+        return py::int_(roundToInt(value));
+    case ScriptParameter::BOOLEAN:
+        return py::bool_(value > 0.5f);
+    case ScriptParameter::CATEGORICAL:
+        if (scriptParameter.categories.isEmpty())
+            return py::none();
+
+        return py::str(scriptParameter.categories[jlimit(0, scriptParameter.categories.size() - 1, roundToInt(value))].toStdString());
+    default:
+        return py::float_(value);
+    }
+}
+
+/** Converts a saved value to the var type expected by a parameter */
+static var toParameterValue(ScriptParameter::Type type, double value)
+{
+    switch (type)
+    {
+    case ScriptParameter::INT:
+    case ScriptParameter::CATEGORICAL:
+        return var(roundToInt(value));
+    case ScriptParameter::BOOLEAN:
+        return var(value > 0.5);
+    default:
+        return var(value);
+    }
+}
+
+
 PythonProcessor::PythonProcessor()
-    : GenericProcessor("Python Processor")
+    : GenericProcessor("Python Processor"),
+      broadcastFifo(MAX_QUEUED_BROADCAST_MESSAGES)
 {
     pyModule = NULL;
     pyObject = NULL;
+    pyParams = NULL;
     moduleReady = false;
     scriptPath = "";
     moduleName = "";
     editorPtr = NULL;
+    parameterVersion = 0;
+    processTakesBlockInfo = false;
+    dataLayout = Marshalling::Layout::CHANNELS_BY_SAMPLES;
+    droppedBroadcastMessages = 0;
+    handlesBroadcastMessages = false;
 
     addStringParameter(Parameter::GLOBAL_SCOPE, "script_path", "Path to python script", String());
+
+    addCategoricalParameter(Parameter::GLOBAL_SCOPE, "gc_mode", "When Python's garbage collector runs during acquisition",
+                            { "Automatic", "Idle gaps", "Timer" }, 0, true);
+    addIntParameter(Parameter::GLOBAL_SCOPE, "gc_interval", "Interval between collections in Timer mode (ms)",
+                    10000, 100, 600000, true);
+
+    addStringParameter(Parameter::GLOBAL_SCOPE, "cpu_affinity", "Cores for the processing thread, e.g. 2-5,8 (empty for any)",
+                       String(), true);
+    addCategoricalParameter(Parameter::GLOBAL_SCOPE, "thread_policy", "Scheduling policy for the processing thread",
+                            { "Default", "Nice", "FIFO", "RR" }, 0, true);
+    addIntParameter(Parameter::GLOBAL_SCOPE, "thread_priority", "Nice level (-20 to 19) or real-time priority (1 to 99)",
+                    0, -20, 99, true);
+    addBooleanParameter(Parameter::GLOBAL_SCOPE, "lock_memory", "Lock the pages of the GUI process in memory during acquisition",
+                        false, true);
+
+    addCategoricalParameter(Parameter::GLOBAL_SCOPE, "data_type", "Element type of the array passed to process()",
+                            { "float32", "float64" }, 0, true);
+    addCategoricalParameter(Parameter::GLOBAL_SCOPE, "data_layout", "Shape of the array passed to process()",
+                            { "channels x samples", "samples x channels" }, 0, true);
+
+    memoryMonitor = std::make_unique<PythonMemoryMonitor>();
 }
 
 PythonProcessor::~PythonProcessor()
@@ -53,6 +141,11 @@ PythonProcessor::~PythonProcessor()
 
     delete pyModule;
     delete pyObject;
+    delete pyParams;
+
+    clearBlockInfos();
+
+    dataType = py::dtype();
 }
 
 
@@ -75,6 +168,31 @@ void PythonProcessor::updateSettings()
     if (numContinuousChannels > 0) {
         sampleRate = continuousChannels.getFirst()->getSampleRate();
     }
+
+    // Choose the copy kernels for each stream once, along with its buffer channel indices
+    const auto type = (Marshalling::DataType) (int) getParameter("data_type")->getValue();
+    const auto layout = (Marshalling::Layout) (int) getParameter("data_layout")->getValue();
+
+    std::map<uint16, Marshalling::Plan> plans;
+
+    for (auto stream : getDataStreams())
+    {
+        std::vector<int> channelIndex;
+
+        for (int i = 0; i < stream->getChannelCount(); ++i)
+            channelIndex.push_back(getGlobalChannelIndex(stream->getStreamId(), i));
+
+        plans[stream->getStreamId()] = Marshalling::createPlan(type, layout, channelIndex);
+    }
+
+    {
+        // process() reads these with the GIL held
+        py::gil_scoped_acquire acquire;
+
+        marshallingPlans.swap(plans);
+        dataLayout = layout;
+        dataType = type == Marshalling::DataType::FLOAT32 ? py::dtype::of<float>() : py::dtype::of<double>();
+    }
     
 
     if (moduleReady)
@@ -86,8 +204,35 @@ void PythonProcessor::updateSettings()
             pyObject = NULL;
         }
 
+        clearBlockInfos();
+
         try {
-            pyObject = new py::object(pyModule->attr("PyProcessor")(numContinuousChannels, sampleRate));
+            py::module_::import("oe_pyprocessor");
+
+            for (auto stream : getDataStreams())
+            {
+                BlockInfo* info = new BlockInfo(stream->getStreamId(), stream->getSampleRate());
+                py::object* object = new py::object(py::cast(info, py::return_value_policy::take_ownership));
+
+                blockInfos[stream->getStreamId()] = { object, info };
+            }
+
+            py::object pyClass = pyModule->attr("PyProcessor");
+
+            // Set on the class as well, so __init__ can read the declared values
+            if (pyParams)
+                pyClass.attr("params") = *pyParams;
+
+            pyObject = new py::object(pyClass(numContinuousChannels, sampleRate));
+
+            // Scripts written before block metadata existed take only the data array
+            py::object signature = py::module_::import("inspect").attr("signature")(pyObject->attr("process"));
+            processTakesBlockInfo = py::len(signature.attr("parameters")) >= 2;
+
+            if (pyParams)
+                pyObject->attr("params") = *pyParams;
+
+            handlesBroadcastMessages = py::hasattr(*pyObject, "handle_broadcast_message");
         }
 
         catch (py::error_already_set& e) {
@@ -96,8 +241,18 @@ void PythonProcessor::updateSettings()
     }
 }
 
+void PythonProcessor::clearBlockInfos()
+{
+    for (auto& it : blockInfos)
+        delete it.second.object;
+
+    blockInfos.clear();
+}
+
 void PythonProcessor::process(AudioBuffer<float>& buffer)
 {
+    threadScheduler.beginBlock();
+
     checkForEvents(true);
 
 
@@ -105,6 +260,19 @@ void PythonProcessor::process(AudioBuffer<float>& buffer)
     {
         py::gil_scoped_acquire acquire;
 
+        // A reload on the message thread can fail to recreate the object
+        // while this thread waits for the GIL
+        if (pyObject == NULL)
+        {
+            threadScheduler.endBlock();
+            return;
+        }
+
+        updatePythonParameters();
+        deliverBroadcastMessages();
+
+        memoryMonitor->beginBlock();
+
         for (auto stream : getDataStreams())
         {
 
@@ -119,40 +287,65 @@ void PythonProcessor::process(AudioBuffer<float>& buffer)
                 // Only for blocks bigger than 0
                 if (numSamples > 0) 
                 {
-                    py::array_t<float> numpyArray = py::array_t<float>({ numChannels, numSamples });
+                    auto plan = marshallingPlans.find(streamId);
 
-                    // Read into numpy array
-                    for (int i = 0; i < numChannels; ++i) {
-                        int globalChannelIndex = getGlobalChannelIndex(stream->getStreamId(), i);
+                    if (plan == marshallingPlans.end())
+                        continue;
 
-                        const float* bufferChannelPtr = buffer.getReadPointer(globalChannelIndex);
-                        float* numpyChannelPtr = numpyArray.mutable_data(i, 0);
-                        memcpy(numpyChannelPtr, bufferChannelPtr, sizeof(float) * numSamples);
-                    }
+                    const Marshalling::Kernel& kernel = plan->second.getKernel(numSamples);
+                    const int* channelIndex = plan->second.channelIndex.data();
+
+                    py::array numpyArray = dataLayout == Marshalling::Layout::CHANNELS_BY_SAMPLES
+                        ? py::array(dataType, { numChannels, numSamples })
+                        : py::array(dataType, { numSamples, numChannels });
+
+                    // Read into numpy array
+                    int64 marshallingStart = Time::getHighResolutionTicks();
+                    kernel.pack(buffer.getArrayOfReadPointers(), channelIndex, numpyArray.mutable_data(), numChannels, numSamples);
+                    int64 marshallingTicks = Time::getHighResolutionTicks() - marshallingStart;
 
                     // Call python script on this block
 
                     try {
-                        pyObject->attr("process")(numpyArray);
+                        auto blockInfo = blockInfos.find(streamId);
+
+                        if (processTakesBlockInfo && blockInfo != blockInfos.end())
+                        {
+                            blockInfo->second.info->startBlock(getFirstSampleNumberForBlock(streamId),
+                                                               getFirstTimestampForBlock(streamId),
+                                                               numSamples);
+
+                            pyObject->attr("process")(numpyArray, *blockInfo->second.object);
+                        }
+                        else
+                        {
+                            pyObject->attr("process")(numpyArray);
+                        }
                     }
                     catch (py::error_already_set& e) {
                         handlePythonException(e);
                     }
 
 
-                    // Write from numpy array?
-                    for (int i = 0; i < numChannels; ++i) {
-                        int globalChannelIndex = getGlobalChannelIndex(stream->getStreamId(), i);
+                    // Write from numpy array
+                    marshallingStart = Time::getHighResolutionTicks();
+                    kernel.unpack(numpyArray.data(), buffer.getArrayOfWritePointers(), channelIndex, numChannels, numSamples);
+                    marshallingTicks += Time::getHighResolutionTicks() - marshallingStart;
 
-                        float* bufferChannelPtr = buffer.getWritePointer(globalChannelIndex);
-                        const float* numpyChannelPtr = numpyArray.data(i, 0);
-                        memcpy(bufferChannelPtr, numpyChannelPtr, sizeof(float) * numSamples);
-                    }
+                    threadScheduler.addMarshallingTime(Time::highResolutionTicksToSeconds(marshallingTicks) * 1000.0);
                 }
             
             }
         }
+
+        memoryMonitor->endBlock();
+
+        // Events for the next block are recorded from here on
+        for (auto& it : blockInfos)
+            it.second.info->clearEvents();
     }
+
+    threadScheduler.endBlock();
 }
 
 void PythonProcessor::handleTTLEvent(TTLEventPtr event)
@@ -167,6 +360,15 @@ void PythonProcessor::handleTTLEvent(TTLEventPtr event)
     // Give to python
     py::gil_scoped_acquire acquire;
 
+    if (pyObject == NULL)
+        return;
+
+    // Record for the block metadata, as an offset from the first sample of the block
+    auto blockInfo = blockInfos.find(streamId);
+
+    if (blockInfo != blockInfos.end())
+        blockInfo->second.info->addTtlEvent(sampleNumber - getFirstSampleNumberForBlock(streamId), line, state);
+
     try {
         pyObject->attr("handle_ttl_event")(state, sampleNumber, channel, line, streamId);
     }
@@ -179,6 +381,10 @@ void PythonProcessor::handleTTLEvent(TTLEventPtr event)
 void PythonProcessor::handleSpike(SpikePtr event)
 {
     py::gil_scoped_acquire acquire;
+
+    if (pyObject == NULL)
+        return;
+
     try {
         pyObject->attr("handle_spike_event")();
     }
@@ -190,23 +396,132 @@ void PythonProcessor::handleSpike(SpikePtr event)
 
 void PythonProcessor::handleBroadcastMessage(String message)
 {
+    // Queue the message; Python sees it at the start of the next block
+    int start1, size1, start2, size2;
+    broadcastFifo.prepareToWrite(1, start1, size1, start2, size2);
+
+    if (size1 > 0)
+    {
+        broadcastQueue[start1] = message;
+        broadcastFifo.finishedWrite(1);
+    }
+    else
+    {
+        droppedBroadcastMessages++;
+    }
+}
+
+
+void PythonProcessor::deliverBroadcastMessages()
+{
+    int start1, size1, start2, size2;
+    broadcastFifo.prepareToRead(broadcastFifo.getNumReady(), start1, size1, start2, size2);
+
+    if (size1 + size2 == 0)
+        return;
+
+    if (handlesBroadcastMessages)
+    {
+        try {
+            for (int i = start1; i < start1 + size1; ++i)
+                pyObject->attr("handle_broadcast_message")(broadcastQueue[i].toStdString());
+
+            for (int i = start2; i < start2 + size2; ++i)
+                pyObject->attr("handle_broadcast_message")(broadcastQueue[i].toStdString());
+        }
+        catch (py::error_already_set& e) {
+            handlePythonException(e);
+        }
+    }
+
+    broadcastFifo.finishedRead(size1 + size2);
+}
+
+
+void PythonProcessor::updatePythonParameters()
+{
+    if (pyParams == NULL || !parameterSnapshot.read(parameterValues, parameterVersion))
+        return;
 
+    for (int i = 0; i < scriptParameters.size() && i < parameterValues.size(); ++i)
+    {
+        pyParams->attr(scriptParameters[i].name.toRawUTF8()) = toPythonValue(scriptParameters[i], parameterValues[i]);
+    }
+}
+
+
+int PythonProcessor::getScriptParameterIndex(const String& name) const
+{
+    for (int i = 0; i < scriptParameters.size(); ++i)
+    {
+        if (scriptParameters[i].name == name)
+            return i;
+    }
+
+    return -1;
 }
 
 
 void PythonProcessor::saveCustomParametersToXml(XmlElement* parentElement)
 {
+    // Script parameters are declared after the module is imported, so their
+    // values are saved here as well as with the other processor parameters.
+    // Only parameters the current script declares are saved
+    XmlElement* scriptParametersXml = parentElement->createNewChildElement("SCRIPT_PARAMETERS");
 
+    for (auto& scriptParameter : scriptParameters)
+    {
+        XmlElement* parameterXml = scriptParametersXml->createNewChildElement("PARAMETER");
+        parameterXml->setAttribute("name", scriptParameter.name);
+        parameterXml->setAttribute("value", (double) getParameter(scriptParameter.name)->getValue());
+    }
 }
 
 
 void PythonProcessor::loadCustomParametersFromXml(XmlElement* parentElement)
 {
+    XmlElement* scriptParametersXml = parentElement->getChildByName("SCRIPT_PARAMETERS");
+
+    if (scriptParametersXml == nullptr)
+        return;
 
+    for (auto* parameterXml : scriptParametersXml->getChildWithTagNameIterator("PARAMETER"))
+    {
+        const String name = parameterXml->getStringAttribute("name");
+        const double value = parameterXml->getDoubleAttribute("value");
+
+        int index = getScriptParameterIndex(name);
+
+        if (index >= 0)
+            getParameter(name)->setNextValue(toParameterValue(scriptParameters[index].type, value));
+        else
+            pendingParameterValues.set(name, value);
+    }
 }
 
 bool PythonProcessor::startAcquisition() 
 {
+    memoryMonitor->startAcquisition((GCMode) (int) getParameter("gc_mode")->getValue(),
+                                    (int) getParameter("gc_interval")->getValue());
+
+    {
+        py::gil_scoped_acquire acquire;
+
+        for (auto& it : blockInfos)
+            it.second.info->reset();
+    }
+
+    // Applied by the processing thread at the first block
+    if (!threadScheduler.configure(getParameter("cpu_affinity")->getValueAsString(),
+                                   (ThreadPolicy) (int) getParameter("thread_policy")->getValue(),
+                                   (int) getParameter("thread_priority")->getValue()))
+    {
+        LOGC("Invalid CPU affinity list: ", getParameter("cpu_affinity")->getValueAsString());
+    }
+
+    threadScheduler.reset();
+    threadScheduler.setMemoryLocked((bool) getParameter("lock_memory")->getValue());
+
     if (moduleReady)
     {
         py::gil_scoped_acquire acquire;
@@ -223,6 +538,18 @@ bool PythonProcessor::startAcquisition()
 }
 
 bool PythonProcessor::stopAcquisition() {
+    if (droppedBroadcastMessages > 0)
+    {
+        LOGC("Dropped ", droppedBroadcastMessages.load(), " broadcast messages (queue full)");
+        droppedBroadcastMessages = 0;
+    }
+
+    memoryMonitor->stopAcquisition();
+
+    LOGC("Processing thread: ", threadScheduler.getDetails().replace("\n", ", "));
+    threadScheduler.release();
+    threadScheduler.setMemoryLocked(false);
+
     if (moduleReady)
     {
         py::gil_scoped_acquire acquire;
@@ -265,12 +592,23 @@ void PythonProcessor::stopRecording() {
 
 void PythonProcessor::parameterValueChanged(Parameter* param)
 {
-    if (param->getName().equalsIgnoreCase("script_path")) 
+    if (param->getName().equalsIgnoreCase("data_type") || param->getName().equalsIgnoreCase("data_layout"))
+    {
+        updateSettings();
+    }
+    else if (param->getName().equalsIgnoreCase("script_path")) 
     {
         scriptPath = param->getValueAsString();
         importModule();
         updateSettings();
     }
+    else
+    {
+        int index = getScriptParameterIndex(param->getName());
+
+        if (index >= 0)
+            parameterSnapshot.publish(index, (float) param->getValue());
+    }
 }
 
 
@@ -311,6 +649,13 @@ bool PythonProcessor::importModule()
 
         LOGC("Successfully imported ", moduleName);
 
+        if (!loadScriptParameters())
+        {
+            editorPtr->setPathLabelText("(ERROR) " + moduleName);
+            moduleReady = false;
+            return false;
+        }
+
         editorPtr->setPathLabelText(moduleName);
         moduleReady = true;
         return true;
@@ -343,6 +688,13 @@ void PythonProcessor::reload()
             return;
         }
         
+        if (!loadScriptParameters())
+        {
+            moduleReady = false;
+            editorPtr->setPathLabelText("(ERROR) " + moduleName);
+            return;
+        }
+
         LOGC("Module successfully reloaded");
         moduleReady = true;
         editorPtr->setPathLabelText(moduleName);
@@ -353,6 +705,205 @@ void PythonProcessor::reload()
     }
 }
 
+bool PythonProcessor::loadScriptParameters()
+{
+    // Every declaration is parsed and checked before anything is changed, so a
+    // bad declaration leaves the current parameters and self.params as they were
+    std::vector<ScriptParameterDeclaration> declarations;
+
+    if (!py::hasattr(*pyModule, "PyProcessor"))
+    {
+        LOGC("Module ", moduleName, " has no PyProcessor class");
+        return false;
+    }
+
+    try
+    {
+        declarations = parseScriptParameters(pyModule->attr("PyProcessor"));
+    }
+    catch (std::exception& exc)
+    {
+        LOGC("Invalid script parameter declaration in ", moduleName, ": ", exc.what());
+        return false;
+    }
+
+    scriptParameters.clear();
+
+    for (auto& declaration : declarations)
+    {
+        const ScriptParameter& scriptParameter = declaration.parameter;
+
+        if (getParameter(scriptParameter.name) == nullptr)
+        {
+            switch (scriptParameter.type)
+            {
+            case ScriptParameter::FLOAT:
+                addFloatParameter(Parameter::GLOBAL_SCOPE, scriptParameter.name, declaration.description,
+                                  (float) declaration.defaultValue,
+                                  (float) declaration.minValue,
+                                  (float) declaration.maxValue,
+                                  (float) declaration.step);
+                break;
+            case ScriptParameter::INT:
+                addIntParameter(Parameter::GLOBAL_SCOPE, scriptParameter.name, declaration.description,
+                                (int) declaration.defaultValue,
+                                (int) declaration.minValue,
+                                (int) declaration.maxValue);
+                break;
+            case ScriptParameter::BOOLEAN:
+                addBooleanParameter(Parameter::GLOBAL_SCOPE, scriptParameter.name, declaration.description,
+                                    declaration.defaultValue > 0.5);
+                break;
+            case ScriptParameter::CATEGORICAL:
+                addCategoricalParameter(Parameter::GLOBAL_SCOPE, scriptParameter.name, declaration.description,
+                                        scriptParameter.categories,
+                                        (int) declaration.defaultValue);
+                break;
+            }
+
+            declaredParameters[scriptParameter.name] = scriptParameter;
+        }
+
+        scriptParameters.push_back(scriptParameter);
+    }
+
+    // Start the snapshot from the current parameter values
+    parameterSnapshot.reset((int) scriptParameters.size());
+    parameterValues.resize(scriptParameters.size());
+    parameterVersion = 0;
+
+    py::object simpleNamespace = py::module_::import("types").attr("SimpleNamespace");
+
+    delete pyParams;
+    pyParams = new py::object(simpleNamespace());
+
+    for (int i = 0; i < scriptParameters.size(); ++i)
+    {
+        Parameter* param = getParameter(scriptParameters[i].name);
+
+        if (pendingParameterValues.contains(param->getName()))
+        {
+            param->setNextValue(toParameterValue(scriptParameters[i].type, pendingParameterValues[param->getName()]));
+            pendingParameterValues.remove(param->getName());
+        }
+
+        parameterSnapshot.publish(i, (float) param->getValue());
+        pyParams->attr(scriptParameters[i].name.toRawUTF8()) = toPythonValue(scriptParameters[i], (float) param->getValue());
+    }
+
+    if (editorPtr)
+        editorPtr->updateScriptParameterEditors();
+
+    return true;
+}
+
+
+std::vector<ScriptParameterDeclaration> PythonProcessor::parseScriptParameters(const py::object& pyClass)
+{
+    std::vector<ScriptParameterDeclaration> declarations;
+
+    if (!py::hasattr(pyClass, "parameters"))
+        return declarations;
+
+    StringArray names;
+
+    for (auto item : pyClass.attr("parameters"))
+    {
+        py::dict declaration = item.cast<py::dict>();
+
+        if (!declaration.contains("name"))
+            throw std::runtime_error("a parameter has no 'name'");
+
+        ScriptParameterDeclaration parsed;
+        ScriptParameter& scriptParameter = parsed.parameter;
+        scriptParameter.name = declaration["name"].cast<std::string>();
+
+        // Names the errors below after the parameter they belong to
+        auto get = [&](const char* key) -> py::object
+        {
+            if (!declaration.contains(key))
+                throw std::runtime_error(scriptParameter.name.toStdString() + " has no '" + key + "'");
+
+            return declaration[key];
+        };
+
+        try
+        {
+            std::string type = declaration.contains("type") ? declaration["type"].cast<std::string>() : "float";
+            parsed.description = declaration.contains("description") ? declaration["description"].cast<std::string>() : scriptParameter.name.toStdString();
+
+            if (type == "float")
+            {
+                scriptParameter.type = ScriptParameter::FLOAT;
+                parsed.defaultValue = get("default").cast<float>();
+                parsed.minValue = get("min").cast<float>();
+                parsed.maxValue = get("max").cast<float>();
+                parsed.step = declaration.contains("step") ? declaration["step"].cast<float>() : 1.0f;
+            }
+            else if (type == "int")
+            {
+                scriptParameter.type = ScriptParameter::INT;
+                parsed.defaultValue = get("default").cast<int>();
+                parsed.minValue = get("min").cast<int>();
+                parsed.maxValue = get("max").cast<int>();
+            }
+            else if (type == "bool")
+            {
+                scriptParameter.type = ScriptParameter::BOOLEAN;
+                parsed.defaultValue = get("default").cast<bool>() ? 1.0 : 0.0;
+            }
+            else if (type == "categorical")
+            {
+                scriptParameter.type = ScriptParameter::CATEGORICAL;
+
+                for (auto category : get("categories"))
+                    scriptParameter.categories.add(category.cast<std::string>());
+
+                if (scriptParameter.categories.isEmpty())
+                    throw std::runtime_error("no categories");
+
+                parsed.defaultValue = declaration.contains("default") ? declaration["default"].cast<int>() : 0;
+            }
+            else
+            {
+                throw std::runtime_error("unknown type '" + type + "'");
+            }
+        }
+        catch (py::cast_error& exc)
+        {
+            throw std::runtime_error(scriptParameter.name.toStdString() + ": wrong value type (" + exc.what() + ")");
+        }
+        catch (py::error_already_set& exc)
+        {
+            throw std::runtime_error(scriptParameter.name.toStdString() + ": " + exc.what());
+        }
+
+        if (names.contains(scriptParameter.name))
+            throw std::runtime_error(scriptParameter.name.toStdString() + " is declared twice");
+
+        names.add(scriptParameter.name);
+
+        auto declared = declaredParameters.find(scriptParameter.name);
+
+        if (getParameter(scriptParameter.name) != nullptr && declared == declaredParameters.end())
+            throw std::runtime_error(scriptParameter.name.toStdString() + " is a reserved name");
+
+        // Parameters can't be removed or recreated once added, so a
+        // redeclaration has to match the parameter that already exists
+        if (declared != declaredParameters.end()
+            && (declared->second.type != scriptParameter.type || declared->second.categories != scriptParameter.categories))
+        {
+            throw std::runtime_error(scriptParameter.name.toStdString()
+                + " was declared with a different type or categories; use a new name or re-add the processor");
+        }
+
+        declarations.push_back(parsed);
+    }
+
+    return declarations;
+}
+
+
 void PythonProcessor::handlePythonException(py::error_already_set e)
 {
     LOGC("Python Exception:\n", e.what());
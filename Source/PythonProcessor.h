@@ -27,10 +27,51 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <pybind11/embed.h>
 #include <pybind11/numpy.h>
 
+#include <atomic>
+#include <map>
+
+#include "BlockInfo.h"
+#include "MarshallingKernels.h"
+#include "ParameterSnapshot.h"
+#include "PythonMemoryMonitor.h"
+#include "ThreadScheduler.h"
 #include "PythonProcessorEditor.h"
 
 namespace py = pybind11;
 
+/** Describes a parameter declared by the PyProcessor class */
+struct ScriptParameter
+{
+	enum Type { FLOAT, INT, BOOLEAN, CATEGORICAL };
+
+	/** Name of the parameter, used as the attribute name in Python */
+	String name;
+
+	/** Parameter type */
+	Type type;
+
+	/** Category names (categorical parameters only) */
+	StringArray categories;
+};
+
+/** A script parameter declaration, parsed and checked before any parameter is created */
+struct ScriptParameterDeclaration
+{
+	ScriptParameter parameter;
+
+	/** Description shown in the parameter tooltip */
+	String description;
+
+	/** Default, range and step (bool and categorical use the default only) */
+	double defaultValue = 0.0;
+	double minValue = 0.0;
+	double maxValue = 0.0;
+	double step = 1.0;
+};
+
+/** Maximum number of broadcast messages queued between two blocks */
+#define MAX_QUEUED_BROADCAST_MESSAGES 64
+
 class PythonProcessor : public GenericProcessor
 {
 
@@ -51,12 +92,96 @@ private:
 	/** Name of module */
 	std::string moduleName;
 
-	/** True if there is an module loaded with no exceptions*/
-	bool moduleReady;
+	/** True if there is an module loaded with no exceptions. Read by the
+	processing thread before it takes the GIL*/
+	std::atomic<bool> moduleReady;
 
 	/** Pointer to editor */
 	PythonProcessorEditor* editorPtr;
 
+	/** Parameters declared by the current PyProcessor class */
+	std::vector<ScriptParameter> scriptParameters;
+
+	/** Script parameter values, published from the message thread */
+	ParameterSnapshot parameterSnapshot;
+
+	/** Last snapshot values seen by the processing thread */
+	std::vector<float> parameterValues;
+
+	/** Snapshot version last pushed to Python */
+	uint64_t parameterVersion;
+
+	/** Namespace object exposed to the script as self.params */
+	py::object* pyParams;
+
+	/** First declaration of each parameter created for scripts loaded by this node */
+	std::map<String, ScriptParameter> declaredParameters;
+
+	/** Script parameter values loaded from XML before the module declared them */
+	NamedValueSet pendingParameterValues;
+
+	/** Broadcast messages waiting to be passed to Python at the next block */
+	AbstractFifo broadcastFifo;
+	String broadcastQueue[MAX_QUEUED_BROADCAST_MESSAGES];
+
+	/** Number of broadcast messages dropped because the queue was full */
+	std::atomic<int> droppedBroadcastMessages;
+
+	/** True if the PyProcessor instance defines handle_broadcast_message */
+	bool handlesBroadcastMessages;
+
+	/** Block metadata object for one stream, owned by Python */
+	struct StreamBlockInfo
+	{
+		py::object* object;
+		BlockInfo* info;
+	};
+
+	/** Reused block metadata for each stream. Only accessed with the GIL held,
+		so updateSettings can rebuild it during acquisition */
+	std::map<uint16, StreamBlockInfo> blockInfos;
+
+	/** True if PyProcessor.process() accepts a block metadata argument */
+	bool processTakesBlockInfo;
+
+	/** Deletes the block metadata objects. Must be called with the GIL held */
+	void clearBlockInfos();
+
+	/** Copy kernels and channel index table for each stream. Swapped in with the GIL
+		held, and only rebuilt by updateSettings, which can't run during acquisition */
+	std::map<uint16, Marshalling::Plan> marshallingPlans;
+
+	/** Element type and shape of the arrays passed to process() */
+	py::dtype dataType;
+	Marshalling::Layout dataLayout;
+
+	/** Python memory and garbage collector statistics */
+	std::unique_ptr<PythonMemoryMonitor> memoryMonitor;
+
+	/** Affinity, scheduling and jitter statistics for the processing thread */
+	ThreadScheduler threadScheduler;
+
+	/** Reads the parameter declarations of the PyProcessor class and creates
+		matching processor parameters. If any declaration is invalid, logs the
+		error and returns false without changing anything. Must be called with
+		the GIL held */
+	bool loadScriptParameters();
+
+	/** Parses and checks every declaration in PyProcessor.parameters. Throws
+		std::exception with a message naming the bad parameter */
+	std::vector<ScriptParameterDeclaration> parseScriptParameters(const py::object& pyClass);
+
+	/** Pushes changed script parameter values to self.params. Called
+		from the processing thread with the GIL held */
+	void updatePythonParameters();
+
+	/** Passes queued broadcast messages to Python. Called from the
+		processing thread with the GIL held */
+	void deliverBroadcastMessages();
+
+	/** Returns the index of a script parameter, or -1 if there is none with this name */
+	int getScriptParameterIndex(const String& name) const;
+
 
 public:
 	/** The class constructor, used to initialize any members. */
@@ -123,6 +248,15 @@ public:
 	/** Reloads the current python module if one is loaded */
 	void reload();
 
+	/** Returns the Python memory monitor for this processor */
+	PythonMemoryMonitor* getMemoryMonitor() { return memoryMonitor.get(); }
+
+	/** Returns the thread scheduler for this processor */
+	ThreadScheduler* getThreadScheduler() { return &threadScheduler; }
+
+	/** Returns the parameters declared by the current PyProcessor class */
+	const std::vector<ScriptParameter>& getScriptParameters() const { return scriptParameters; }
+
 	/** Deals with python exceptions (print and turn off module for now) */
 	void handlePythonException(py::error_already_set e);
 
@@ -57,7 +57,7 @@ PythonProcessorEditor::PythonProcessorEditor(PythonProcessor* parentNode)
 	// Set ptr to parent
 	pythonProcessor = parentNode;
 
-    desiredWidth = 200;
+    desiredWidth = 580;
 
 	scriptPathLabel = new Label("Script Path Label", "No Module Loaded");
 	scriptPathLabel->setTooltip(scriptPathLabel->getText());
@@ -73,10 +73,46 @@ PythonProcessorEditor::PythonProcessorEditor(PythonProcessor* parentNode)
 	addCustomParameterEditor(new ScriptPathButton(scriptPathPtr), 162, 35);
 
 	reimportButton = new UtilityButton("Reload", Font(12));
-	reimportButton->setBounds(60, 80, 80, 30);
+	reimportButton->setBounds(20, 65, 65, 22);
 	reimportButton->addListener(this);
 	addAndMakeVisible(reimportButton);
 
+	snapshotButton = new UtilityButton("Snapshot", Font(12));
+	snapshotButton->setTooltip("Log the largest Python allocation sites (tracemalloc)");
+	snapshotButton->setBounds(92, 65, 65, 22);
+	snapshotButton->addListener(this);
+	addAndMakeVisible(snapshotButton);
+
+	stopTracingButton = new UtilityButton("x", Font(12));
+	stopTracingButton->setTooltip("Stop tracemalloc (also stopped when acquisition stops)");
+	stopTracingButton->setBounds(162, 65, 22, 22);
+	stopTracingButton->addListener(this);
+	stopTracingButton->setEnabled(false);
+	addAndMakeVisible(stopTracingButton);
+
+	memoryStatsLabel = new Label("Memory Stats Label", "");
+	memoryStatsLabel->setFont(Font(11));
+	memoryStatsLabel->setMinimumHorizontalScale(0.7f);
+	memoryStatsLabel->setBounds(10, 92, 180, 18);
+	addAndMakeVisible(memoryStatsLabel);
+
+	threadStatsLabel = new Label("Thread Stats Label", "");
+	threadStatsLabel->setFont(Font(11));
+	threadStatsLabel->setMinimumHorizontalScale(0.7f);
+	threadStatsLabel->setBounds(10, 110, 180, 18);
+	addAndMakeVisible(threadStatsLabel);
+
+	addComboBoxParameterEditor("gc_mode", 195, 22);
+	addTextBoxParameterEditor("gc_interval", 195, 67);
+
+	addTextBoxParameterEditor("cpu_affinity", 295, 22);
+	addComboBoxParameterEditor("thread_policy", 295, 67);
+	addTextBoxParameterEditor("thread_priority", 390, 22);
+	addCheckBoxParameterEditor("lock_memory", 390, 67);
+
+	addComboBoxParameterEditor("data_type", 485, 22);
+	addComboBoxParameterEditor("data_layout", 485, 67);
+
 }
 
 void PythonProcessorEditor::buttonClicked(Button* button)
@@ -87,7 +123,44 @@ void PythonProcessorEditor::buttonClicked(Button* button)
 		pythonProcessor->reload();
 		pythonProcessor->updateSettings();
 	}
+	else if (button == snapshotButton)
+	{
+		pythonProcessor->getMemoryMonitor()->takeSnapshot();
+		stopTracingButton->setEnabled(pythonProcessor->getMemoryMonitor()->isTracing());
+	}
+	else if (button == stopTracingButton)
+	{
+		pythonProcessor->getMemoryMonitor()->stopTracing();
+		stopTracingButton->setEnabled(false);
+	}
+
+}
+
+void PythonProcessorEditor::startAcquisition()
+{
+	GenericEditor::startAcquisition();
+	startTimer(500);
+}
+
+void PythonProcessorEditor::stopAcquisition()
+{
+	GenericEditor::stopAcquisition();
+	stopTimer();
+	timerCallback();
+}
 
+void PythonProcessorEditor::timerCallback()
+{
+	PythonMemoryMonitor* monitor = pythonProcessor->getMemoryMonitor();
+
+	memoryStatsLabel->setText(monitor->getSummary(), dontSendNotification);
+	memoryStatsLabel->setTooltip(monitor->getDetails());
+	stopTracingButton->setEnabled(monitor->isTracing());
+
+	ThreadScheduler* scheduler = pythonProcessor->getThreadScheduler();
+
+	threadStatsLabel->setText(scheduler->getSummary(), dontSendNotification);
+	threadStatsLabel->setTooltip(scheduler->getDetails());
 }
 
 void PythonProcessorEditor::setPathLabelText(String s)
@@ -96,4 +169,56 @@ void PythonProcessorEditor::setPathLabelText(String s)
 	scriptPathLabel->setTooltip(s);
 }
 
+void PythonProcessorEditor::updateScriptParameterEditors()
+{
+	const int firstColumnX = 580;
+	const int columnWidth = 90;
+	const int rowsPerColumn = 3;
+
+	// Parameters can't be removed from the processor, so editors of parameters
+	// the current script no longer declares are hidden until it declares them again
+	for (auto& entry : scriptParameterEditors)
+		entry.second->setVisible(false);
+
+	int index = 0;
+
+	for (auto& scriptParameter : pythonProcessor->getScriptParameters())
+	{
+		const int x = firstColumnX + (index / rowsPerColumn) * columnWidth;
+		const int y = 22 + (index % rowsPerColumn) * 40;
+
+		ParameterEditor*& editor = scriptParameterEditors[scriptParameter.name];
+
+		if (editor == nullptr)
+		{
+			Parameter* param = getProcessor()->getParameter(scriptParameter.name);
+
+			switch (scriptParameter.type)
+			{
+			case ScriptParameter::BOOLEAN:
+				editor = new CheckBoxParameterEditor(param);
+				break;
+			case ScriptParameter::CATEGORICAL:
+				editor = new ComboBoxParameterEditor(param);
+				break;
+			default:
+				editor = new TextBoxParameterEditor(param);
+				break;
+			}
+
+			addCustomParameterEditor(editor, x, y);
+		}
+		else
+		{
+			editor->setTopLeftPosition(x, y);
+			editor->setVisible(true);
+		}
+
+		index++;
+	}
+
+	const int numColumns = (index + rowsPerColumn - 1) / rowsPerColumn;
+	setDesiredWidth(firstColumnX + numColumns * columnWidth);
+}
+
 
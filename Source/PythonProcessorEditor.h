@@ -25,6 +25,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <EditorHeaders.h>
 
+#include <map>
+
 class PythonProcessor;
 
 /** Custom parameter editor for changing the script path*/
@@ -56,7 +58,8 @@ private:
 
 class PythonProcessorEditor :
 	public GenericEditor,
-	public Button::Listener
+	public Button::Listener,
+	public Timer
 {
 public:
 
@@ -69,16 +72,36 @@ public:
 	/** Respond to button clicks*/
 	void buttonClicked(Button* button);
 
+	/** Starts updating the memory and thread statistics */
+	void startAcquisition() override;
+
+	/** Stops updating the memory and thread statistics */
+	void stopAcquisition() override;
+
+	/** Refreshes the memory and thread statistics labels */
+	void timerCallback() override;
+
 	/** Sets the text of the path label */
 	void setPathLabelText(String);
 
+	/** Shows editors for the parameters declared by the current script, adding
+		any that don't have one yet, and hides the rest */
+	void updateScriptParameterEditors();
+
 private:
 
 	PythonProcessor* pythonProcessor;
 
+	/** Editors created for script parameters, by name (owned by GenericEditor) */
+	std::map<String, ParameterEditor*> scriptParameterEditors;
+
 	ScopedPointer<Label> scriptPathLabel;
 	ScopedPointer<Button> scriptPathButton;
 	ScopedPointer<Button> reimportButton;
+	ScopedPointer<Button> snapshotButton;
+	ScopedPointer<Button> stopTracingButton;
+	ScopedPointer<Label> memoryStatsLabel;
+	ScopedPointer<Label> threadStatsLabel;
 
 	/** Generates an assertion if this class leaks */
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PythonProcessorEditor);
@@ -0,0 +1,527 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThreadScheduler.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#if JUCE_WINDOWS
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#if JUCE_LINUX
+#include <sys/syscall.h>
+#endif
+
+
+void JitterStats::reset()
+{
+    count = 0;
+    mean = 0.0;
+    m2 = 0.0;
+    max = 0.0;
+}
+
+void JitterStats::add(double ms)
+{
+    // Welford's algorithm; only this thread writes, so plain loads are enough
+    const int64 n = count + 1;
+    const double delta = ms - mean;
+    const double newMean = mean + delta / n;
+
+    m2 = m2 + delta * (ms - newMean);
+    mean = newMean;
+    count = n;
+
+    if (ms > max)
+        max = ms;
+}
+
+double JitterStats::getStdDev() const
+{
+    const int64 n = count;
+    return n > 1 ? std::sqrt(m2 / (n - 1)) : 0.0;
+}
+
+
+/** Scheduling of the processing thread before it was first changed, and the
+    identity of that thread so the settings can be restored from another thread */
+struct OriginalSettings
+{
+#if JUCE_WINDOWS
+    DWORD threadId = 0;
+    DWORD_PTR affinityMask = 0;
+    int priority = THREAD_PRIORITY_NORMAL;
+#else
+    int policy = SCHED_OTHER;
+    sched_param param = {};
+#endif
+#if JUCE_LINUX
+    pid_t tid = 0;
+    int nice = 0;
+    cpu_set_t affinity;
+#endif
+};
+
+/** The processing thread and the process's memory are shared by every
+    PythonProcessor node, so their settings are owned process-wide: one node at
+    a time may change the thread, and memory locking is reference counted */
+struct SharedThreadState
+{
+    CriticalSection lock;
+
+    /** Node whose thread settings are in effect, if any */
+    const ThreadScheduler* owner = nullptr;
+
+    /** True while the processing thread differs from original */
+    bool modified = false;
+
+    /** Set when the settings must be restored from the processing thread itself (macOS) */
+    std::atomic<bool> restorePending { false };
+
+    OriginalSettings original;
+
+    /** Number of nodes that currently want memory locked */
+    int memoryLockCount = 0;
+};
+
+static SharedThreadState& getSharedState()
+{
+    static SharedThreadState state;
+    return state;
+}
+
+/** Puts the processing thread back to its original settings. Called with the
+    shared lock held, from any thread except on macOS. Returns a status message */
+static String restoreOriginalSettings(SharedThreadState& shared)
+{
+    String result;
+    const OriginalSettings& original = shared.original;
+
+#if JUCE_WINDOWS
+    HANDLE thread = OpenThread(THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION, FALSE, original.threadId);
+
+    if (thread == NULL)
+        return "thread no longer exists";
+
+    if (SetThreadAffinityMask(thread, original.affinityMask) == 0)
+        result << "affinity failed (error " << (int) GetLastError() << "); ";
+
+    if (!SetThreadPriority(thread, original.priority))
+        result << "priority failed (error " << (int) GetLastError() << "); ";
+
+    CloseHandle(thread);
+#elif JUCE_LINUX
+    // Thread ids rather than pthread_t, which can't be used once the thread is gone
+    if (sched_setaffinity(original.tid, sizeof(cpu_set_t), &original.affinity) != 0)
+        result << "affinity failed (" << strerror(errno) << "); ";
+
+    if (sched_setscheduler(original.tid, original.policy, &original.param) != 0)
+        result << "scheduling policy failed (" << strerror(errno) << "); ";
+
+    if (setpriority(PRIO_PROCESS, original.tid, original.nice) != 0)
+        result << "nice failed (" << strerror(errno) << "); ";
+#else
+    const int error = pthread_setschedparam(pthread_self(), original.policy, &original.param);
+
+    if (error != 0)
+        result << "scheduling policy failed (" << strerror(error) << "); ";
+#endif
+
+    shared.modified = false;
+
+    return result.isEmpty() ? String("restored") : result;
+}
+
+
+ThreadScheduler::ThreadScheduler()
+{
+    policy = ThreadPolicy::DEFAULT;
+    priority = 0;
+    settingsPending = false;
+    memoryLocked = false;
+    blockStartTicks = 0;
+    lastBlockStartTicks = 0;
+    lastCpu = -1;
+    currentCpu = -1;
+    migrations = 0;
+}
+
+ThreadScheduler::~ThreadScheduler()
+{
+    release();
+    setMemoryLocked(false);
+}
+
+
+bool ThreadScheduler::configure(const String& cpuSet, ThreadPolicy policy_, int priority_)
+{
+    Array<int> newCpus;
+    bool valid = true;
+
+    for (auto token : StringArray::fromTokens(cpuSet, ",", ""))
+    {
+        token = token.trim();
+
+        if (token.isEmpty())
+            continue;
+
+        const String first = token.upToFirstOccurrenceOf("-", false, false).trim();
+        const String last = token.fromFirstOccurrenceOf("-", false, false).trim();
+
+        if (!first.containsOnly("0123456789") || first.isEmpty() || !last.containsOnly("0123456789"))
+        {
+            valid = false;
+            continue;
+        }
+
+        const int start = first.getIntValue();
+        const int end = last.isEmpty() ? start : last.getIntValue();
+
+        for (int cpu = start; cpu <= end; ++cpu)
+            newCpus.addIfNotAlreadyThere(cpu);
+    }
+
+    SharedThreadState& shared = getSharedState();
+    const ScopedLock lock(shared.lock);
+
+    settingsPending = false;
+
+    if (newCpus.isEmpty() && policy_ == ThreadPolicy::DEFAULT)
+    {
+        setStatus("default");
+        return valid;
+    }
+
+    if (shared.owner != nullptr && shared.owner != this)
+    {
+        LOGC("The processing thread settings are already set by another Python Processor, ignoring this node's settings");
+        setStatus("ignored, set by another Python Processor");
+        return valid;
+    }
+
+    // Only takes effect at the next block, when acquisition has started
+    shared.owner = this;
+    cpus = newCpus;
+    policy = policy_;
+    priority = priority_;
+    settingsPending = true;
+
+    return valid;
+}
+
+
+void ThreadScheduler::release()
+{
+    SharedThreadState& shared = getSharedState();
+    const ScopedLock lock(shared.lock);
+
+    settingsPending = false;
+
+    if (shared.owner != this)
+        return;
+
+    shared.owner = nullptr;
+
+    if (!shared.modified)
+        return;
+
+#if JUCE_MAC
+    // pthread_t can't safely be used from another thread, so the next block restores it
+    shared.restorePending = true;
+    setStatus("restore pending");
+#else
+    const String result = restoreOriginalSettings(shared);
+    setStatus(result);
+
+    if (result != "restored")
+        LOGC("Failed to restore the processing thread settings: ", result);
+#endif
+}
+
+
+void ThreadScheduler::setMemoryLocked(bool locked)
+{
+    if (locked == memoryLocked)
+        return;
+
+#if JUCE_WINDOWS
+    if (locked)
+        LOGC("Locking memory is not supported on Windows");
+#else
+    SharedThreadState& shared = getSharedState();
+    const ScopedLock lock(shared.lock);
+
+    // mlockall applies to the whole process, so only the first node locks
+    // and the last one to let go unlocks. MCL_FUTURE is left out on purpose:
+    // Python allocations would start failing once RLIMIT_MEMLOCK is reached
+    if (locked)
+    {
+        if (shared.memoryLockCount == 0 && mlockall(MCL_CURRENT) != 0)
+        {
+            LOGC("Failed to lock memory: ", strerror(errno));
+            return;
+        }
+
+        shared.memoryLockCount++;
+    }
+    else if (--shared.memoryLockCount == 0)
+    {
+        munlockall();
+    }
+
+    memoryLocked = locked;
+#endif
+}
+
+
+void ThreadScheduler::setStatus(const String& newStatus)
+{
+    const SpinLock::ScopedLockType lock(statusLock);
+    status = newStatus;
+}
+
+
+void ThreadScheduler::reset()
+{
+    intervalStats.reset();
+    durationStats.reset();
+    marshallingStats.reset();
+    lastBlockStartTicks = 0;
+    lastCpu = -1;
+    migrations = 0;
+}
+
+
+void ThreadScheduler::beginBlock()
+{
+    if (settingsPending.exchange(false))
+    {
+        setStatus(applyToCurrentThread());
+    }
+#if JUCE_MAC
+    else if (getSharedState().restorePending)
+    {
+        SharedThreadState& shared = getSharedState();
+        const ScopedLock lock(shared.lock);
+
+        if (shared.restorePending.exchange(false) && shared.owner == nullptr && shared.modified)
+            restoreOriginalSettings(shared);
+    }
+#endif
+
+    blockStartTicks = Time::getHighResolutionTicks();
+
+    if (lastBlockStartTicks > 0)
+        intervalStats.add(Time::highResolutionTicksToSeconds(blockStartTicks - lastBlockStartTicks) * 1000.0);
+
+    lastBlockStartTicks = blockStartTicks;
+
+    const int cpu = getCurrentCpu();
+
+    if (lastCpu >= 0 && cpu != lastCpu)
+        migrations++;
+
+    lastCpu = cpu;
+    currentCpu = cpu;
+}
+
+
+void ThreadScheduler::endBlock()
+{
+    durationStats.add(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - blockStartTicks) * 1000.0);
+}
+
+
+String ThreadScheduler::applyToCurrentThread()
+{
+    SharedThreadState& shared = getSharedState();
+    const ScopedLock lock(shared.lock);
+
+    // Released, or taken over, between configure() and this block
+    if (shared.owner != this)
+        return "not applied";
+
+    OriginalSettings& original = shared.original;
+    String result;
+
+#if JUCE_WINDOWS
+    HANDLE thread = GetCurrentThread();
+
+    if (!shared.modified)
+    {
+        DWORD_PTR processMask, systemMask;
+        GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+
+        original.threadId = GetCurrentThreadId();
+        original.affinityMask = processMask;
+        original.priority = GetThreadPriority(thread);
+    }
+
+    shared.modified = true;
+
+    DWORD_PTR mask = 0;
+
+    for (auto cpu : cpus)
+    {
+        if (cpu < 8 * (int) sizeof(DWORD_PTR))
+            mask |= (DWORD_PTR) 1 << cpu;
+    }
+
+    if (SetThreadAffinityMask(thread, mask != 0 ? mask : original.affinityMask) == 0)
+        result << "affinity failed (error " << (int) GetLastError() << "); ";
+
+    int threadPriority = original.priority;
+
+    if (policy == ThreadPolicy::FIFO || policy == ThreadPolicy::RR)
+        threadPriority = priority >= 50 ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+    else if (policy == ThreadPolicy::NICE)
+        threadPriority = priority < 0 ? THREAD_PRIORITY_ABOVE_NORMAL : (priority > 0 ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_NORMAL);
+
+    if (!SetThreadPriority(thread, threadPriority))
+        result << "priority failed (error " << (int) GetLastError() << "); ";
+#else
+    pthread_t thread = pthread_self();
+    int error = 0;
+
+    shared.restorePending = false;
+
+    if (!shared.modified)
+    {
+        pthread_getschedparam(thread, &original.policy, &original.param);
+#if JUCE_LINUX
+        original.tid = (pid_t) syscall(SYS_gettid);
+        pthread_getaffinity_np(thread, sizeof(cpu_set_t), &original.affinity);
+        original.nice = getpriority(PRIO_PROCESS, original.tid);
+#endif
+    }
+
+    shared.modified = true;
+
+#if JUCE_LINUX
+    cpu_set_t affinity = original.affinity;
+
+    if (cpus.size() > 0)
+    {
+        CPU_ZERO(&affinity);
+
+        for (auto cpu : cpus)
+        {
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &affinity);
+        }
+    }
+
+    error = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &affinity);
+
+    if (error != 0)
+        result << "affinity failed (" << strerror(error) << "); ";
+#else
+    if (cpus.size() > 0)
+        result << "CPU affinity is not supported on macOS; ";
+#endif
+
+    int threadPolicy = original.policy;
+    sched_param param = original.param;
+
+    if (policy == ThreadPolicy::FIFO || policy == ThreadPolicy::RR)
+    {
+        threadPolicy = policy == ThreadPolicy::FIFO ? SCHED_FIFO : SCHED_RR;
+        param.sched_priority = jlimit(sched_get_priority_min(threadPolicy), sched_get_priority_max(threadPolicy), priority);
+    }
+    else if (policy == ThreadPolicy::NICE)
+    {
+        threadPolicy = SCHED_OTHER;
+        param.sched_priority = 0;
+    }
+
+    error = pthread_setschedparam(thread, threadPolicy, &param);
+
+    if (error != 0)
+        result << "scheduling policy failed (" << strerror(error) << "); ";
+
+#if JUCE_LINUX
+    // On Linux the nice level of a thread id applies to that thread only
+    const int nice = policy == ThreadPolicy::NICE ? jlimit(-20, 19, priority) : original.nice;
+
+    if (setpriority(PRIO_PROCESS, original.tid, nice) != 0)
+        result << "nice failed (" << strerror(errno) << "); ";
+#else
+    if (policy == ThreadPolicy::NICE)
+        result << "per-thread nice levels are not supported on macOS; ";
+#endif
+#endif
+
+    if (result.isEmpty())
+        result = "applied";
+
+    return result;
+}
+
+
+int ThreadScheduler::getCurrentCpu()
+{
+#if JUCE_LINUX
+    return sched_getcpu();
+#elif JUCE_WINDOWS
+    return (int) GetCurrentProcessorNumber();
+#else
+    return -1;
+#endif
+}
+
+
+String ThreadScheduler::getSummary() const
+{
+    return "Jitter " + String(intervalStats.getStdDev(), 2) + " ms, CPU " + String(currentCpu.load())
+        + ", " + String(migrations.load()) + " mig.";
+}
+
+
+String ThreadScheduler::getDetails() const
+{
+    String details;
+
+    {
+        const SpinLock::ScopedLockType lock(statusLock);
+        details << "Thread settings: " << (status.isEmpty() ? String("not applied") : status) << "\n";
+    }
+
+    details << "Block interval: mean " << String(intervalStats.getMean(), 2) << " ms, std "
+        << String(intervalStats.getStdDev(), 2) << " ms, max " << String(intervalStats.getMax(), 2) << " ms\n";
+    details << "Process time: mean " << String(durationStats.getMean(), 2) << " ms, std "
+        << String(durationStats.getStdDev(), 2) << " ms, max " << String(durationStats.getMax(), 2) << " ms\n";
+    details << "Copy to/from Python: mean " << String(marshallingStats.getMean(), 3) << " ms, max "
+        << String(marshallingStats.getMax(), 3) << " ms\n";
+    details << "CPU: " << currentCpu.load() << ", migrations: " << migrations.load()
+        << ", memory " << (memoryLocked ? "locked" : "not locked");
+
+    return details;
+}
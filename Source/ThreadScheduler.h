@@ -0,0 +1,151 @@
+/*
+------------------------------------------------------------------
+
+This file is part of the Open Ephys GUI
+Copyright (C) 2022 Open Ephys
+
+------------------------------------------------------------------
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADSCHEDULER_H_DEFINED
+#define THREADSCHEDULER_H_DEFINED
+
+#include <ProcessorHeaders.h>
+
+#include <atomic>
+
+/** Scheduling policy requested for the processing thread */
+enum class ThreadPolicy
+{
+	DEFAULT = 0,	// leave the thread as the GUI created it
+	NICE,			// normal scheduling with a nice level (-20 to 19)
+	FIFO,			// SCHED_FIFO with a real-time priority (1 to 99)
+	RR				// SCHED_RR with a real-time priority (1 to 99)
+};
+
+/** Running mean, standard deviation and maximum of a timing measurement,
+	written by one thread and read by another */
+class JitterStats
+{
+public:
+
+	/** Constructor */
+	JitterStats() { reset(); }
+
+	/** Clears all values (writer thread, or while the writer is idle) */
+	void reset();
+
+	/** Adds a measurement in milliseconds (writer thread only) */
+	void add(double ms);
+
+	int64 getCount() const { return count; }
+	double getMean() const { return mean; }
+	double getMax() const { return max; }
+
+	/** Returns the standard deviation in milliseconds */
+	double getStdDev() const;
+
+private:
+
+	std::atomic<int64> count;
+	std::atomic<double> mean;
+	std::atomic<double> m2;
+	std::atomic<double> max;
+};
+
+/** Applies CPU affinity, scheduling policy and memory locking settings to the
+	thread that calls PythonProcessor::process, and measures its timing jitter.
+
+	The settings are applied from the processing thread itself at the first block
+	after they change, since the GUI owns that thread, and restored when the node
+	releases them. The thread is shared with every processor in the signal chain,
+	so only one node at a time may change it; settings from other nodes are
+	ignored with a log message. */
+class ThreadScheduler
+{
+public:
+
+	/** Constructor */
+	ThreadScheduler();
+
+	/** Destructor, restores the thread and unlocks memory if this node changed them */
+	~ThreadScheduler();
+
+	/** Sets the affinity and scheduling for the processing thread (message thread, not
+		during acquisition). cpuSet is a list of cores and ranges, such as "2-5,8".
+		Returns false if cpuSet can't be parsed */
+	bool configure(const String& cpuSet, ThreadPolicy policy, int priority);
+
+	/** Restores the processing thread's original settings if this node changed
+		them (message thread, called when acquisition stops) */
+	void release();
+
+	/** Locks or unlocks the pages currently mapped by the GUI process (message thread).
+		Memory stays locked while any node wants it locked */
+	void setMemoryLocked(bool locked);
+
+	/** Clears the timing statistics (called at the start of acquisition) */
+	void reset();
+
+	/** Called at the start of process(). Applies pending settings and records timing */
+	void beginBlock();
+
+	/** Called at the end of process() */
+	void endBlock();
+
+	/** Records the time spent copying one block to and from Python */
+	void addMarshallingTime(double ms) { marshallingStats.add(ms); }
+
+	/** Short summary for the editor */
+	String getSummary() const;
+
+	/** Full statistics and status for the editor tooltip and log */
+	String getDetails() const;
+
+private:
+
+	/** Applies the configured settings to the calling thread. Returns a status message */
+	String applyToCurrentThread();
+
+	/** Sets the status shown in the editor tooltip */
+	void setStatus(const String& newStatus);
+
+	/** Returns the index of the core the calling thread is running on, or -1 */
+	static int getCurrentCpu();
+
+	Array<int> cpus;
+	ThreadPolicy policy;
+	int priority;
+
+	std::atomic<bool> settingsPending;
+	bool memoryLocked;
+
+	/** Status of the last attempt to apply the settings */
+	String status;
+	mutable SpinLock statusLock;
+
+	int64 blockStartTicks;
+	int64 lastBlockStartTicks;
+	int lastCpu;
+
+	JitterStats intervalStats;
+	JitterStats durationStats;
+	JitterStats marshallingStats;
+	std::atomic<int> currentCpu;
+	std::atomic<int64> migrations;
+};
+
+#endif // THREADSCHEDULER_H_DEFINED